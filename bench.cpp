@@ -0,0 +1,251 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/ip.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#define PORT 2203
+
+// Load generator for the server: every connection runs on its own thread and
+// sends batches of `pipeline` requests, then waits for all of their responses.
+
+struct BenchOptions {
+    int conns = 8;
+    long requests = 100000;
+    int pipeline = 16;
+    size_t value_size = 32;
+    int keyspace = 1000;
+    std::string type = "get";
+};
+
+static BenchOptions g_opts;
+
+static void die(const char *msg) {
+    int err = errno;
+    fprintf(stderr, "[%d] %s\n", err, msg);
+    abort();
+}
+
+static int32_t write_all(int fd, const char *buf, size_t n) {
+    while (n > 0) {
+        ssize_t rv = write(fd, buf, n);
+        if (rv <= 0) {
+            return -1;  // error
+        }
+        assert((size_t)rv <= n);
+        n -= (size_t)rv;
+        buf += rv;
+    }
+    return 0;
+}
+
+static int connect_server() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        die("socket()");
+    }
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = ntohs(PORT);
+    addr.sin_addr.s_addr = ntohl(INADDR_LOOPBACK);  // 127.0.0.1
+    if (connect(fd, (const struct sockaddr *)&addr, sizeof(addr))) {
+        die("connect");
+    }
+    return fd;
+}
+
+static void append_u32(std::string &out, uint32_t v) {
+    out.append((const char *)&v, 4);
+}
+
+// Same framing as client.cpp: total length, argument count, then
+// length-prefixed arguments
+static void append_req(std::string &out, const std::vector<std::string> &cmd) {
+    uint32_t len = 4;
+    for (const std::string &s : cmd) {
+        len += 4 + s.size();
+    }
+    append_u32(out, len);
+    append_u32(out, cmd.size());
+    for (const std::string &s : cmd) {
+        append_u32(out, s.size());
+        out.append(s);
+    }
+}
+
+// Read until `count` complete responses arrived. Returns how many had a
+// non-zero status, or -1 on a connection error.
+static long read_responses(int fd, std::string &rbuf, int count) {
+    long errors = 0;
+    size_t pos = 0;
+    char chunk[64 * 1024];
+    while (count > 0) {
+        if (rbuf.size() - pos >= 4) {
+            uint32_t len = 0;
+            memcpy(&len, rbuf.data() + pos, 4);
+            if (rbuf.size() - pos >= 4 + (size_t)len) {
+                uint32_t status = 0;
+                if (len >= 4) {
+                    memcpy(&status, rbuf.data() + pos + 4, 4);
+                }
+                errors += status != 0;
+                pos += 4 + len;
+                count--;
+                continue;
+            }
+        }
+        ssize_t rv = read(fd, chunk, sizeof(chunk));
+        if (rv <= 0) {
+            return -1;
+        }
+        rbuf.append(chunk, rv);
+    }
+    rbuf.erase(0, pos);
+    return errors;
+}
+
+static std::string key_name(long i) {
+    return "bench:" + std::to_string(i % g_opts.keyspace);
+}
+
+struct Worker {
+    long requests = 0;
+    long errors = 0;
+    std::vector<double> batch_us;
+};
+
+static void run_worker(Worker *w, int id) {
+    int fd = connect_server();
+    std::string value(g_opts.value_size, 'x');
+    std::string wbuf, rbuf;
+    long sent = 0;
+    long seq = id;
+    while (sent < w->requests) {
+        int batch = (int)std::min<long>(g_opts.pipeline, w->requests - sent);
+        wbuf.clear();
+        for (int i = 0; i < batch; i++, seq += g_opts.conns) {
+            bool is_set = g_opts.type == "set" || (g_opts.type == "mixed" && seq % 10 == 0);
+            if (is_set) {
+                append_req(wbuf, {"set", key_name(seq), value});
+            } else {
+                append_req(wbuf, {"get", key_name(seq)});
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        if (write_all(fd, wbuf.data(), wbuf.size())) {
+            die("write()");
+        }
+        long errors = read_responses(fd, rbuf, batch);
+        if (errors < 0) {
+            die("read()");
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        w->errors += errors;
+        w->batch_us.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+        sent += batch;
+    }
+    close(fd);
+}
+
+// Make sure every key of the keyspace exists before a get benchmark
+static void prefill() {
+    int fd = connect_server();
+    std::string value(g_opts.value_size, 'x');
+    std::string wbuf, rbuf;
+    for (long i = 0; i < g_opts.keyspace; i += 256) {
+        wbuf.clear();
+        long batch = std::min<long>(256, g_opts.keyspace - i);
+        for (long j = 0; j < batch; j++) {
+            append_req(wbuf, {"set", key_name(i + j), value});
+        }
+        if (write_all(fd, wbuf.data(), wbuf.size()) || read_responses(fd, rbuf, batch) < 0) {
+            die("prefill");
+        }
+    }
+    close(fd);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-c conns] [-n requests] [-P pipeline] [-d value_size]\n"
+            "          [-k keyspace] [-t get|set|mixed]\n",
+            prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+        }
+        const char *arg = argv[i];
+        const char *val = argv[++i];
+        if (!strcmp(arg, "-c")) {
+            g_opts.conns = atoi(val);
+        } else if (!strcmp(arg, "-n")) {
+            g_opts.requests = atol(val);
+        } else if (!strcmp(arg, "-P")) {
+            g_opts.pipeline = atoi(val);
+        } else if (!strcmp(arg, "-d")) {
+            g_opts.value_size = (size_t)atol(val);
+        } else if (!strcmp(arg, "-k")) {
+            g_opts.keyspace = atoi(val);
+        } else if (!strcmp(arg, "-t")) {
+            g_opts.type = val;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (g_opts.conns < 1 || g_opts.pipeline < 1 || g_opts.keyspace < 1 || g_opts.requests < 1 ||
+        (g_opts.type != "get" && g_opts.type != "set" && g_opts.type != "mixed")) {
+        usage(argv[0]);
+    }
+
+    if (g_opts.type != "set") {
+        prefill();
+    }
+
+    std::vector<Worker> workers(g_opts.conns);
+    for (int i = 0; i < g_opts.conns; i++) {
+        workers[i].requests = g_opts.requests / g_opts.conns + (i < g_opts.requests % g_opts.conns);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < g_opts.conns; i++) {
+        threads.push_back(std::thread(run_worker, &workers[i], i));
+    }
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    long errors = 0;
+    std::vector<double> lat;
+    for (Worker &w : workers) {
+        errors += w.errors;
+        lat.insert(lat.end(), w.batch_us.begin(), w.batch_us.end());
+    }
+    std::sort(lat.begin(), lat.end());
+
+    printf("%s: %ld requests, %d conns, pipeline %d, %zu byte values\n",
+           g_opts.type.c_str(), g_opts.requests, g_opts.conns, g_opts.pipeline, g_opts.value_size);
+    printf("elapsed %.3f s, %.0f requests/s, %ld non-ok responses\n",
+           elapsed, g_opts.requests / elapsed, errors);
+    printf("batch latency (us): p50 %.1f  p99 %.1f  max %.1f\n",
+           lat[lat.size() / 2], lat[lat.size() * 99 / 100], lat.back());
+    return 0;
+}
@@ -23,13 +23,25 @@
 #include <unordered_map>
 #include <list>
 #include <set>
+#include <algorithm>
+#include <memory>
+#include <atomic>
+#include <deque>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <signal.h>
+#include <linux/io_uring.h>
 
 //definitions
 #define PORT 2203
 
 // Data structures for expiration support
 struct Entry {
-    std::string value;
+    // Immutable once stored; queued responses hold a reference instead of a copy
+    std::shared_ptr<const std::string> value;
     std::string ttl; // cached TTL string for response lifetime
     std::chrono::steady_clock::time_point created_at;
     std::chrono::steady_clock::time_point expires_at;
@@ -39,53 +51,61 @@ struct Entry {
     bool has_ttl = false;
 };
 
-static std::unordered_map<std::string, Entry> g_data;
-static std::mutex g_data_mutex;
-
-// LRU tracking
-static std::list<std::string> lru_list;
-
-// LFU tracking (frequency -> list of keys)
-static std::map<size_t, std::list<std::string>> lfu_map;
-static std::unordered_map<std::string, std::map<size_t, std::list<std::string>>::iterator> lfu_key_to_freq;
+// Keyspace shard. The keyspace is partitioned by key hash, one shard per
+// event loop; only the owning loop serves requests against its shard.
+struct Shard {
+    std::unordered_map<std::string, Entry> data;
+    
+    // LRU tracking
+    std::list<std::string> lru_list;
+    
+    // LFU tracking (frequency -> list of keys)
+    std::map<size_t, std::list<std::string>> lfu_map;
+    std::unordered_map<std::string, std::map<size_t, std::list<std::string>>::iterator> lfu_key_to_freq;
+    
+    // TTL tracking
+    std::set<std::pair<std::chrono::steady_clock::time_point, std::string>> ttl_set;
+    
+    // Shared only with the background cleanup thread
+    std::mutex mutex;
+};
 
-// TTL tracking
-static std::set<std::pair<std::chrono::steady_clock::time_point, std::string>> ttl_set;
+static std::vector<std::unique_ptr<Shard>> g_shards;
 
 // Helper functions for expiration mechanisms
-static void update_lru(const std::string& key) {
-    auto it = g_data.find(key);
-    if (it != g_data.end()) {
-        lru_list.erase(it->second.lru_it);
-        lru_list.push_front(key);
-        it->second.lru_it = lru_list.begin();
+static void update_lru(Shard &sh, const std::string& key) {
+    auto it = sh.data.find(key);
+    if (it != sh.data.end()) {
+        sh.lru_list.erase(it->second.lru_it);
+        sh.lru_list.push_front(key);
+        it->second.lru_it = sh.lru_list.begin();
     }
 }
 
-static void update_lfu(const std::string& key) {
-    auto it = g_data.find(key);
-    if (it != g_data.end()) {
+static void update_lfu(Shard &sh, const std::string& key) {
+    auto it = sh.data.find(key);
+    if (it != sh.data.end()) {
         // Remove from LFU tracking
         if (it->second.access_count >= 0) {
-            auto freq_it = lfu_key_to_freq[key];
+            auto freq_it = sh.lfu_key_to_freq[key];
             freq_it->second.erase(it->second.lfu_it);
             if (freq_it->second.empty()) {
-                lfu_map.erase(freq_it);
+                sh.lfu_map.erase(freq_it);
             }
-            lfu_key_to_freq.erase(key);
+            sh.lfu_key_to_freq.erase(key);
         }
         
         // Update access count
         it->second.access_count++;
         
         // Add to new frequency list
-        auto new_freq_it = lfu_map.find(it->second.access_count);
-        if (new_freq_it == lfu_map.end()) {
-            new_freq_it = lfu_map.insert({it->second.access_count, std::list<std::string>()}).first;
+        auto new_freq_it = sh.lfu_map.find(it->second.access_count);
+        if (new_freq_it == sh.lfu_map.end()) {
+            new_freq_it = sh.lfu_map.insert({it->second.access_count, std::list<std::string>()}).first;
         }
         new_freq_it->second.push_front(key);
         it->second.lfu_it = new_freq_it->second.begin();
-        lfu_key_to_freq[key] = new_freq_it;
+        sh.lfu_key_to_freq[key] = new_freq_it;
     }
 }
 
@@ -94,32 +114,32 @@ static bool is_expired(const Entry& entry) {
     return std::chrono::steady_clock::now() > entry.expires_at;
 }
 
-static void cleanup_expired() {
-    std::lock_guard<std::mutex> lock(g_data_mutex);
+static void cleanup_expired(Shard &sh) {
+    std::lock_guard<std::mutex> lock(sh.mutex);
     auto now = std::chrono::steady_clock::now();
     
     // Clean up TTL expired entries
-    auto ttl_it = ttl_set.begin();
-    while (ttl_it != ttl_set.end() && ttl_it->first <= now) {
+    auto ttl_it = sh.ttl_set.begin();
+    while (ttl_it != sh.ttl_set.end() && ttl_it->first <= now) {
         const std::string& key = ttl_it->second;
-        auto data_it = g_data.find(key);
-        if (data_it != g_data.end()) {
+        auto data_it = sh.data.find(key);
+        if (data_it != sh.data.end()) {
             // Remove from LRU list
-            lru_list.erase(data_it->second.lru_it);
+            sh.lru_list.erase(data_it->second.lru_it);
             
             // Remove from LFU tracking
             if (data_it->second.access_count >= 0) {
-                auto freq_it = lfu_key_to_freq[key];
+                auto freq_it = sh.lfu_key_to_freq[key];
                 freq_it->second.erase(data_it->second.lfu_it);
                 if (freq_it->second.empty()) {
-                    lfu_map.erase(freq_it);
+                    sh.lfu_map.erase(freq_it);
                 }
-                lfu_key_to_freq.erase(key);
+                sh.lfu_key_to_freq.erase(key);
             }
             
-            g_data.erase(data_it);
+            sh.data.erase(data_it);
         }
-        ttl_set.erase(ttl_it++);
+        sh.ttl_set.erase(ttl_it++);
     }
 }
 
@@ -140,6 +160,100 @@ static void die(const char *msg){
 const size_t max_msg=32<<20;
 const size_t max_args=200*1000;
 
+struct Options{
+    int threads=1;
+    bool io_uring=false;
+    bool edge_triggered=false;
+};
+
+static Options g_opts;
+
+// Connection buffers are built from fixed-size chunks drawn from a pool shared
+// by every connection of the thread, so a buffer grows by linking another
+// chunk instead of reallocating, and consuming never moves bytes.
+const size_t chunk_size=16*1024;
+const size_t chunk_pool_max=1024; // free chunks a thread keeps for reuse
+const size_t large_pool_max=8; // oversized chunks kept, to avoid mmap churn per large frame
+const size_t large_chunk_max=4<<20;
+
+struct Chunk{
+    uint8_t *mem=nullptr;
+    size_t cap=0;
+    size_t head=0; // first unread byte
+    size_t tail=0; // end of data
+    
+    size_t size() const{
+        return tail-head;
+    }
+    
+    size_t space() const{
+        return cap-tail;
+    }
+};
+
+struct ChunkPool{
+    std::vector<uint8_t*> free_list;
+    std::vector<Chunk> large;
+    
+    ~ChunkPool(){
+        for(uint8_t *mem:free_list){
+            delete[] mem;
+        }
+        for(Chunk &c:large){
+            delete[] c.mem;
+        }
+    }
+};
+
+static thread_local ChunkPool t_chunk_pool;
+
+// Chunks larger than chunk_size hold a single large frame; a few of them are
+// cached and reused for frames of up to twice their size
+static Chunk chunk_get(size_t cap=chunk_size){
+    Chunk c;
+    c.cap=std::max(cap,chunk_size);
+    std::vector<uint8_t*> &free_list=t_chunk_pool.free_list;
+    if(c.cap==chunk_size && !free_list.empty()){
+        c.mem=free_list.back();
+        free_list.pop_back();
+        return c;
+    }
+    std::vector<Chunk> &large=t_chunk_pool.large;
+    for(size_t i=0;i<large.size() && c.cap>chunk_size;i++){
+        if(large[i].cap>=c.cap && large[i].cap/2<=c.cap){
+            c=large[i];
+            large[i]=large.back();
+            large.pop_back();
+            return c;
+        }
+    }
+    c.mem=new uint8_t[c.cap];
+    return c;
+}
+
+static void chunk_put(Chunk &c){
+    if(!c.mem){
+        return;
+    }
+    std::vector<uint8_t*> &free_list=t_chunk_pool.free_list;
+    std::vector<Chunk> &large=t_chunk_pool.large;
+    if(c.cap==chunk_size && free_list.size()<chunk_pool_max){
+        free_list.push_back(c.mem);
+    } else if(c.cap>chunk_size && c.cap<=large_chunk_max && large.size()<large_pool_max){
+        large.push_back(c);
+        large.back().head=large.back().tail=0;
+    } else{
+        delete[] c.mem;
+    }
+    c=Chunk();
+}
+
+// io_uring backend: sendmsg arguments of a connection's in-flight send
+struct UringSend{
+    struct msghdr msg;
+    struct iovec iov[16];
+};
+
 struct Conn{
     int fd=-1;
     
@@ -147,54 +261,374 @@ struct Conn{
     bool want_write=false;
     bool want_close=false;
     
-    // Efficient FIFO buffers for incoming/outgoing data
-    // Use a sliding-head vector to allow O(1) amortized pop-front without memmove on every consume
+    // Edge-triggered mode: the socket may still hold unread bytes. epoll
+    // reports readability only once per edge, so it is remembered here
+    // until a read hits EAGAIN.
+    bool readable=false;
+    
+    // Event mask currently registered with epoll, so the loop only issues
+    // EPOLL_CTL_MOD when want_read/want_write actually change.
+    uint32_t events=0;
+    
+    // Identifies this connection in cross-shard replies, since the fd may
+    // have been closed and reused by the time a reply arrives
+    uint64_t id=0;
+    // A request was forwarded to another shard; later requests wait for its
+    // reply so responses stay in pipeline order
+    bool waiting_remote=false;
+    
+    // io_uring backend: requests in flight that still reference this
+    // connection, which is freed once both have completed
+    bool recv_armed=false;
+    bool send_inflight=false;
+    
+    // FIFO buffer for incoming data as a chain of pooled chunks. Reads land
+    // in place in the free tail space; consumed chunks go back to the pool,
+    // so an idle connection holds no buffer memory.
     struct Buffer {
-        std::vector<uint8_t> buf;
-        size_t head = 0;
+        std::deque<Chunk> chunks;
+        size_t total = 0;
+        Chunk spare; // handed out by prepare() for a read to overflow into
+
+        Buffer() {}
+        Buffer(const Buffer&) = delete;
+        Buffer& operator=(const Buffer&) = delete;
+
+        ~Buffer() {
+            clear();
+        }
 
         size_t size() const {
-            return buf.size() - head;
+            return total;
+        }
+
+        // Copy out the first n bytes without consuming them
+        void peek(uint8_t* out, size_t n) const {
+            assert(n <= total);
+            for (auto it = chunks.begin(); n > 0; ++it) {
+                size_t take = std::min(n, it->size());
+                memcpy(out, it->mem + it->head, take);
+                out += take;
+                n -= take;
+            }
         }
 
-        uint8_t* data() {
-            return buf.data() + head;
+        // The first n bytes as one contiguous range. Copies only when they
+        // span chunks, and then only those bytes.
+        const uint8_t* contiguous(size_t n) {
+            assert(n > 0 && n <= total);
+            if (chunks.front().size() >= n) {
+                return chunks.front().mem + chunks.front().head;
+            }
+            Chunk merged = chunk_get(n);
+            while (merged.tail < n) {
+                Chunk &c = chunks.front();
+                size_t take = std::min(c.size(), merged.cap - merged.tail);
+                memcpy(merged.mem + merged.tail, c.mem + c.head, take);
+                merged.tail += take;
+                c.head += take;
+                if (c.size() == 0) {
+                    chunk_put(c);
+                    chunks.pop_front();
+                }
+            }
+            chunks.push_front(merged);
+            return merged.mem;
         }
 
-        const uint8_t* data() const {
-            return buf.data() + head;
+        // Make room for a partially received frame of n bytes in a single
+        // chunk, so the rest of a large value is read in place and never
+        // has to be gathered later
+        void reserve_frame(size_t n) {
+            if (total >= n || (chunks.size() == 1 && chunks.front().cap - chunks.front().head >= n)) {
+                return;
+            }
+            Chunk frame = chunk_get(n);
+            while (!chunks.empty()) {
+                Chunk &c = chunks.front();
+                memcpy(frame.mem + frame.tail, c.mem + c.head, c.size());
+                frame.tail += c.size();
+                chunk_put(c);
+                chunks.pop_front();
+            }
+            chunks.push_back(frame);
+        }
+
+        // Describe the writable space for the next read: the free tail of
+        // the last chunk, followed by a spare chunk so the read is not cut
+        // short at a chunk boundary. Returns the number of iovecs (1 or 2).
+        int prepare(struct iovec* iov) {
+            if (!spare.mem) {
+                spare = chunk_get();
+            }
+            int n = 0;
+            if (!chunks.empty() && chunks.back().space() > 0) {
+                iov[n].iov_base = chunks.back().mem + chunks.back().tail;
+                iov[n].iov_len = chunks.back().space();
+                n++;
+            }
+            iov[n].iov_base = spare.mem;
+            iov[n].iov_len = spare.cap;
+            return n + 1;
+        }
+
+        // Account for `len` bytes read into the space from prepare()
+        void commit(size_t len) {
+            total += len;
+            if (!chunks.empty()) {
+                size_t take = std::min(len, chunks.back().space());
+                chunks.back().tail += take;
+                len -= take;
+            }
+            if (len > 0) {
+                spare.tail = len;
+                chunks.push_back(spare);
+                spare = Chunk();
+            }
         }
 
         void append(const uint8_t* data_ptr, size_t len) {
-            if (len == 0) return;
-            buf.insert(buf.end(), data_ptr, data_ptr + len);
+            while (len > 0) {
+                if (chunks.empty() || chunks.back().space() == 0) {
+                    chunks.push_back(chunk_get());
+                }
+                Chunk &c = chunks.back();
+                size_t take = std::min(len, c.space());
+                memcpy(c.mem + c.tail, data_ptr, take);
+                c.tail += take;
+                data_ptr += take;
+                len -= take;
+                total += take;
+            }
         }
 
         void consume(size_t n) {
-            head += n;
-            if (head > buf.size()) {
-                head = buf.size();
+            total -= std::min(n, total);
+            while (n > 0 && !chunks.empty()) {
+                Chunk &c = chunks.front();
+                size_t take = std::min(n, c.size());
+                c.head += take;
+                n -= take;
+                if (c.size() == 0) {
+                    chunk_put(c);
+                    chunks.pop_front();
+                }
+            }
+            if (total == 0) {
+                clear();
+            }
+        }
+
+        // Return the spare chunk when the socket ran dry, so a connection
+        // waiting for its next request keeps no memory around
+        void release_spare() {
+            if (chunks.empty()) {
+                chunk_put(spare);
+            }
+        }
+
+        void clear() {
+            for (Chunk &c : chunks) {
+                chunk_put(c);
+            }
+            chunks.clear();
+            chunk_put(spare);
+            total = 0;
+        }
+    };
+
+    // Outgoing data as a queue of segments flushed with writev. Small
+    // writes are packed into pooled chunks; large values are referenced in
+    // place so their bytes are never copied in userspace.
+    struct OutQueue {
+        struct Segment {
+            Chunk chunk;
+            std::shared_ptr<const std::string> ref;
+
+            const uint8_t* data() const {
+                return chunk.mem ? chunk.mem + chunk.head : (const uint8_t*)ref->data() + chunk.head;
+            }
+
+            size_t size() const {
+                return chunk.size();
+            }
+        };
+
+        std::deque<Segment> segs;
+        size_t total = 0;
+
+        OutQueue() {}
+        OutQueue(const OutQueue&) = delete;
+        OutQueue& operator=(const OutQueue&) = delete;
+
+        ~OutQueue() {
+            for (Segment &seg : segs) {
+                chunk_put(seg.chunk);
+            }
+        }
+
+        void swap(OutQueue &other) {
+            segs.swap(other.segs);
+            std::swap(total, other.total);
+        }
+
+        size_t size() const {
+            return total;
+        }
+
+        void append(const uint8_t* data_ptr, size_t len) {
+            while (len > 0) {
+                if (segs.empty() || !segs.back().chunk.mem || segs.back().chunk.space() == 0) {
+                    segs.push_back(Segment());
+                    segs.back().chunk = chunk_get();
+                }
+                Chunk &c = segs.back().chunk;
+                size_t take = std::min(len, c.space());
+                memcpy(c.mem + c.tail, data_ptr, take);
+                c.tail += take;
+                data_ptr += take;
+                len -= take;
+                total += take;
             }
-            // Compact when head grows large to reclaim space; amortized O(1)
-            if (head >= 4096 && head * 2 >= buf.size()) {
-                buf.erase(buf.begin(), buf.begin() + head);
-                head = 0;
+        }
+
+        // Queue a range of a stored value without copying it
+        void append_ref(const std::shared_ptr<const std::string> &ref, const uint8_t* data_ptr, size_t len) {
+            if (len == 0) return;
+            segs.push_back(Segment());
+            Segment &seg = segs.back();
+            seg.ref = ref;
+            seg.chunk.head = data_ptr - (const uint8_t*)ref->data();
+            seg.chunk.tail = seg.chunk.head + len;
+            seg.chunk.cap = seg.chunk.tail;
+            total += len;
+        }
+
+        // Describe up to `max` unwritten segments for writev/sendmsg
+        int fill_iov(struct iovec *iov, int max) const {
+            int n = 0;
+            for (auto it = segs.begin(); it != segs.end() && n < max; ++it, ++n) {
+                iov[n].iov_base = (void*)it->data();
+                iov[n].iov_len = it->size();
+            }
+            return n;
+        }
+
+        void consume(size_t n) {
+            total -= std::min(n, total);
+            while (n > 0 && !segs.empty()) {
+                Segment &seg = segs.front();
+                size_t take = std::min(n, seg.size());
+                seg.chunk.head += take;
+                n -= take;
+                if (seg.size() == 0) {
+                    chunk_put(seg.chunk);
+                    segs.pop_front();
+                }
             }
         }
     };
 
     Buffer incoming;
-    Buffer outgoing;
+    OutQueue outgoing;
+    // io_uring backend: segments handed to the kernel by the in-flight send.
+    // Kept apart from `outgoing` so appending responses cannot move them.
+    OutQueue sending;
+    std::unique_ptr<UringSend> uring_send;
 };
 
+// Values at least this large are sent by reference rather than copied
+const size_t zero_copy_min=1024;
+
 struct Response{
     uint32_t status=0;
     uint32_t len=0;
     uint8_t *data=nullptr;
+    // Set when data points into a stored value, to keep it alive after the
+    // shard lock is released
+    std::shared_ptr<const std::string> ref;
 };
 
 // Removed vector-based FIFO helpers; replaced by Conn::Buffer methods
 
+// Bounded lock-free single-producer/single-consumer ring. Capacity must be a
+// power of two.
+template<typename T>
+struct SpscQueue{
+    std::vector<T> slots;
+    size_t mask;
+    std::atomic<size_t> head{0}; // next slot to pop, owned by the consumer
+    char pad[64]; // keep producer and consumer indices on separate cache lines
+    std::atomic<size_t> tail{0}; // next slot to push, owned by the producer
+    
+    explicit SpscQueue(size_t capacity) : slots(capacity), mask(capacity-1){
+        assert(capacity && (capacity & (capacity-1))==0);
+    }
+    
+    bool push(T &item){
+        size_t t=tail.load(std::memory_order_relaxed);
+        if(t-head.load(std::memory_order_acquire)>mask){
+            return false; // full
+        }
+        slots[t & mask]=std::move(item);
+        tail.store(t+1,std::memory_order_release);
+        return true;
+    }
+    
+    bool pop(T &item){
+        size_t h=head.load(std::memory_order_relaxed);
+        if(h==tail.load(std::memory_order_acquire)){
+            return false; // empty
+        }
+        item=std::move(slots[h & mask]);
+        head.store(h+1,std::memory_order_release);
+        return true;
+    }
+};
+
+// Request forwarded to the loop owning the key's shard, or the reply routed
+// back to the originating connection
+struct ShardMsg{
+    bool is_reply=false;
+    int fd=-1;
+    uint64_t conn_id=0;
+    std::vector<std::string> cmd;
+    uint32_t status=0;
+    std::string payload;
+    // Large values travel by reference; the refcount is atomic
+    std::shared_ptr<const std::string> ref;
+};
+
+const size_t shard_queue_cap=4096;
+
+struct Uring;
+
+// One reactor: a listening socket, an epoll instance (or io_uring), the
+// connections accepted on it and the keyspace shard it owns.
+struct EventLoop{
+    int id=0;
+    int listening_sd=-1;
+    int epfd=-1;
+    Uring *uring=nullptr;
+    int wakefd=-1; // eventfd other loops signal after pushing to our inbound queues
+    uint64_t next_conn_id=0;
+    std::vector<Conn*> fd2conn;
+    std::vector<struct epoll_event> epoll_args;
+    
+    // Per destination loop: messages that did not fit into the queue yet,
+    // and whether the destination needs a wakeup at the end of this iteration
+    std::vector<std::deque<ShardMsg>> overflow;
+    std::vector<bool> wake;
+};
+
+static std::vector<EventLoop> g_loops;
+// g_queues[from*nloops+to] carries messages from loop `from` to loop `to`
+static std::vector<std::unique_ptr<SpscQueue<ShardMsg>>> g_queues;
+
+static SpscQueue<ShardMsg> &shard_queue(size_t from, size_t to){
+    return *g_queues[from*g_loops.size()+to];
+}
+
 static void fd_set_nb(int fd){
     
     errno=0;
@@ -232,7 +666,7 @@ static bool read_str(const uint8_t* &curr,const uint8_t *end,size_t n,std::strin
         return false;
     }
     
-    out.assign(curr,curr+n);
+    out.assign((const char*)curr,n);
     curr+=n;
     return true;
 }
@@ -266,25 +700,70 @@ static int32_t parse_req(const uint8_t* data,size_t size,std::vector<std::string
     return 0;
 }
 
-static void make_response(Response &resp,std::vector<uint8_t> &out){
+static void make_response(Response &resp, Conn::OutQueue &out){
     uint32_t resp_len=4+resp.len;
-    // Adapt to Conn::Buffer when used
-    // This overload remains for compatibility when called with a raw vector, but in this code
-    // path we will pass Conn::Buffer, so an overload below handles it.
-    out.insert(out.end(), (const uint8_t*)&resp_len, (const uint8_t*)&resp_len + 4);
-    out.insert(out.end(), (const uint8_t*)&resp.status, (const uint8_t*)&resp.status + 4);
-    if(resp.len>0) out.insert(out.end(), (const uint8_t*)resp.data, (const uint8_t*)resp.data + resp.len);
+    uint8_t header[8];
+    memcpy(header,&resp_len,4);
+    memcpy(header+4,&resp.status,4);
+    out.append(header,8);
+    if(resp.ref && resp.len>=zero_copy_min){
+        out.append_ref(resp.ref,resp.data,resp.len);
+    } else if(resp.len>0){
+        out.append((const uint8_t*)resp.data,resp.len);
+    }
 }
 
-// Overload for Conn::Buffer
-static void make_response(Response &resp, Conn::Buffer &out){
-    uint32_t resp_len=4+resp.len;
-    out.append((const uint8_t*)&resp_len,4);
-    out.append((const uint8_t*)&resp.status,4);
-    if(resp.len>0) out.append((const uint8_t*)resp.data,resp.len);
+static uint32_t conn_events(const Conn *conn){
+    if(g_opts.edge_triggered){
+        // Registered for both directions once; readiness is tracked by the connection
+        return EPOLLIN|EPOLLOUT|EPOLLET|EPOLLERR;
+    }
+    uint32_t events=EPOLLERR;
+    if(conn->want_read){
+        events|=EPOLLIN;
+    }
+    if(conn->want_write){
+        events|=EPOLLOUT;
+    }
+    return events;
 }
 
-static Conn* handle_accept(int fd){
+// Sync the epoll interest set with the connection's current intent.
+static void conn_update_events(int epfd, Conn *conn){
+    uint32_t events=conn_events(conn);
+    if(events==conn->events){
+        return;
+    }
+    
+    struct epoll_event ev={};
+    ev.events=events;
+    ev.data.fd=conn->fd;
+    if(epoll_ctl(epfd,EPOLL_CTL_MOD,conn->fd,&ev)<0){
+        msg_errno("epoll_ctl() error");
+        conn->want_close=true;
+        return;
+    }
+    conn->events=events;
+}
+
+// Track a freshly accepted socket in the loop's fd2conn table
+static Conn *conn_new(EventLoop *loop, int conn_fd){
+    Conn * conn=new Conn();
+    conn->fd=conn_fd;
+    conn->id=++loop->next_conn_id;
+    conn->want_read=true;
+    
+    if(loop->fd2conn.size()<=(size_t)conn_fd){
+        loop->fd2conn.resize(conn_fd+1);
+    }
+    assert(!loop->fd2conn[conn_fd]);
+    loop->fd2conn[conn_fd]=conn;
+    return conn;
+}
+
+static Conn* handle_accept(EventLoop *loop){
+    int epfd=loop->epfd;
+    int fd=loop->listening_sd;
     
     struct sockaddr_in client_addr={};
     socklen_t addrlen=sizeof(client_addr);
@@ -299,53 +778,61 @@ static Conn* handle_accept(int fd){
     fprintf(stderr,"new incoming connection from %u.%u.%u.%u:%u\n",ip & 255,(ip>>8) & 255,(ip>>16) & 255,(ip>>24)&255,ntohs(client_addr.sin_port));
     
     fd_set_nb(conn_fd);
-    Conn * conn=new Conn();
-    conn->fd=conn_fd;
-    conn->want_read=true;
+    Conn * conn=conn_new(loop,conn_fd);
+    
+    struct epoll_event ev={};
+    ev.events=conn_events(conn);
+    ev.data.fd=conn_fd;
+    if(epoll_ctl(epfd,EPOLL_CTL_ADD,conn_fd,&ev)<0){
+        msg_errno("epoll_ctl() error");
+        (void)close(conn_fd);
+        loop->fd2conn[conn_fd]=nullptr;
+        delete conn;
+        return nullptr;
+    }
+    conn->events=ev.events;
     return conn;
 }
 
-static void do_request(Response &resp, std::vector<std::string> &cmd){
+static void do_request(Shard &sh, Response &resp, std::vector<std::string> &cmd){
+    // Caller holds sh.mutex
     resp.status=0;
     
-    // Clean up expired entries before acquiring mutex to avoid deadlock
-    cleanup_expired();
-    std::lock_guard<std::mutex> lock(g_data_mutex);
-    
     if(cmd.size()==2 && cmd[0]=="get"){
-        auto it=g_data.find(cmd[1]);
-        if(it==g_data.end() || is_expired(it->second)){
+        auto it=sh.data.find(cmd[1]);
+        if(it==sh.data.end() || is_expired(it->second)){
             resp.status=RES_NX;
             return;
         }
         
         // Update LRU and LFU tracking
-        update_lru(cmd[1]);
-        update_lfu(cmd[1]);
+        update_lru(sh, cmd[1]);
+        update_lfu(sh, cmd[1]);
         
-        resp.len=it->second.value.size();
-        resp.data=(uint8_t*)it->second.value.data();
+        resp.len=it->second.value->size();
+        resp.data=(uint8_t*)it->second.value->data();
+        resp.ref=it->second.value;
     }
     else if(cmd.size()==3 && cmd[0]=="set"){
         auto now = std::chrono::steady_clock::now();
-        Entry& entry = g_data[cmd[1]];
-        entry.value = cmd[2];
+        Entry& entry = sh.data[cmd[1]];
+        entry.value = std::make_shared<std::string>(std::move(cmd[2]));
         entry.created_at = now;
         entry.has_ttl = false;
         entry.access_count = 0;
         
         // Add to LRU list
-        lru_list.push_front(cmd[1]);
-        entry.lru_it = lru_list.begin();
+        sh.lru_list.push_front(cmd[1]);
+        entry.lru_it = sh.lru_list.begin();
         
         // Add to LFU tracking
-        auto freq_it = lfu_map.find(0);
-        if (freq_it == lfu_map.end()) {
-            freq_it = lfu_map.insert({0, std::list<std::string>()}).first;
+        auto freq_it = sh.lfu_map.find(0);
+        if (freq_it == sh.lfu_map.end()) {
+            freq_it = sh.lfu_map.insert({0, std::list<std::string>()}).first;
         }
         freq_it->second.push_front(cmd[1]);
         entry.lfu_it = freq_it->second.begin();
-        lfu_key_to_freq[cmd[1]] = freq_it;
+        sh.lfu_key_to_freq[cmd[1]] = freq_it;
     }
     else if(cmd.size()==5 && cmd[0]=="set" && cmd[1]=="ex"){
         // set ex key value seconds
@@ -353,56 +840,56 @@ static void do_request(Response &resp, std::vector<std::string> &cmd){
         int seconds = std::stoi(cmd[4]);
         auto expires_at = now + std::chrono::seconds(seconds);
         
-        Entry& entry = g_data[cmd[2]];
-        entry.value = cmd[3];
+        Entry& entry = sh.data[cmd[2]];
+        entry.value = std::make_shared<std::string>(std::move(cmd[3]));
         entry.created_at = now;
         entry.expires_at = expires_at;
         entry.has_ttl = true;
         entry.access_count = 0;
         
         // Add to TTL tracking
-        ttl_set.insert({expires_at, cmd[2]});
+        sh.ttl_set.insert({expires_at, cmd[2]});
         
         // Add to LRU list
-        lru_list.push_front(cmd[2]);
-        entry.lru_it = lru_list.begin();
+        sh.lru_list.push_front(cmd[2]);
+        entry.lru_it = sh.lru_list.begin();
         
         // Add to LFU tracking
-        auto freq_it = lfu_map.find(0);
-        if (freq_it == lfu_map.end()) {
-            freq_it = lfu_map.insert({0, std::list<std::string>()}).first;
+        auto freq_it = sh.lfu_map.find(0);
+        if (freq_it == sh.lfu_map.end()) {
+            freq_it = sh.lfu_map.insert({0, std::list<std::string>()}).first;
         }
         freq_it->second.push_front(cmd[2]);
         entry.lfu_it = freq_it->second.begin();
-        lfu_key_to_freq[cmd[2]] = freq_it;
+        sh.lfu_key_to_freq[cmd[2]] = freq_it;
     }
     else if(cmd.size()==2 && cmd[0]=="del"){
-        auto it = g_data.find(cmd[1]);
-        if (it != g_data.end()) {
+        auto it = sh.data.find(cmd[1]);
+        if (it != sh.data.end()) {
             // Remove from LRU list
-            lru_list.erase(it->second.lru_it);
+            sh.lru_list.erase(it->second.lru_it);
             
             // Remove from LFU tracking
             if (it->second.access_count >= 0) {
-                auto freq_it = lfu_key_to_freq[cmd[1]];
+                auto freq_it = sh.lfu_key_to_freq[cmd[1]];
                 freq_it->second.erase(it->second.lfu_it);
                 if (freq_it->second.empty()) {
-                    lfu_map.erase(freq_it);
+                    sh.lfu_map.erase(freq_it);
                 }
-                lfu_key_to_freq.erase(cmd[1]);
+                sh.lfu_key_to_freq.erase(cmd[1]);
             }
             
             // Remove from TTL tracking
             if (it->second.has_ttl) {
-                ttl_set.erase({it->second.expires_at, cmd[1]});
+                sh.ttl_set.erase({it->second.expires_at, cmd[1]});
             }
             
-            g_data.erase(it);
+            sh.data.erase(it);
         }
     }
     else if(cmd.size()==2 && cmd[0]=="ttl"){
-        auto it = g_data.find(cmd[1]);
-        if(it==g_data.end() || is_expired(it->second)){
+        auto it = sh.data.find(cmd[1]);
+        if(it==sh.data.end() || is_expired(it->second)){
             resp.status=RES_NX;
             return;
         }
@@ -420,65 +907,65 @@ static void do_request(Response &resp, std::vector<std::string> &cmd){
     }
     else if(cmd.size()==1 && cmd[0]=="lru_evict"){
         // Evict least recently used entry
-        if (lru_list.empty()) {
+        if (sh.lru_list.empty()) {
             resp.status = RES_ERR;
             return;
         }
         
-        std::string key_to_evict = lru_list.back();
-        auto it = g_data.find(key_to_evict);
-        if (it != g_data.end()) {
+        std::string key_to_evict = sh.lru_list.back();
+        auto it = sh.data.find(key_to_evict);
+        if (it != sh.data.end()) {
             // Remove from LRU list
-            lru_list.erase(it->second.lru_it);
+            sh.lru_list.erase(it->second.lru_it);
             
             // Remove from LFU tracking
             if (it->second.access_count >= 0) {
-                auto freq_it = lfu_key_to_freq[key_to_evict];
+                auto freq_it = sh.lfu_key_to_freq[key_to_evict];
                 freq_it->second.erase(it->second.lfu_it);
                 if (freq_it->second.empty()) {
-                    lfu_map.erase(freq_it);
+                    sh.lfu_map.erase(freq_it);
                 }
-                lfu_key_to_freq.erase(key_to_evict);
+                sh.lfu_key_to_freq.erase(key_to_evict);
             }
             
             // Remove from TTL tracking
             if (it->second.has_ttl) {
-                ttl_set.erase({it->second.expires_at, key_to_evict});
+                sh.ttl_set.erase({it->second.expires_at, key_to_evict});
             }
             
-            g_data.erase(it);
+            sh.data.erase(it);
         }
     }
     else if(cmd.size()==1 && cmd[0]=="lfu_evict"){
         // Evict least frequently used entry
-        if (lfu_map.empty()) {
+        if (sh.lfu_map.empty()) {
             resp.status = RES_ERR;
             return;
         }
         
-        auto least_freq_it = lfu_map.begin();
+        auto least_freq_it = sh.lfu_map.begin();
         std::string key_to_evict = least_freq_it->second.back();
-        auto it = g_data.find(key_to_evict);
-        if (it != g_data.end()) {
+        auto it = sh.data.find(key_to_evict);
+        if (it != sh.data.end()) {
             // Remove from LRU list
-            lru_list.erase(it->second.lru_it);
+            sh.lru_list.erase(it->second.lru_it);
             
             // Remove from LFU tracking
             if (it->second.access_count >= 0) {
-                auto freq_it = lfu_key_to_freq[key_to_evict];
+                auto freq_it = sh.lfu_key_to_freq[key_to_evict];
                 freq_it->second.erase(it->second.lfu_it);
                 if (freq_it->second.empty()) {
-                    lfu_map.erase(freq_it);
+                    sh.lfu_map.erase(freq_it);
                 }
-                lfu_key_to_freq.erase(key_to_evict);
+                sh.lfu_key_to_freq.erase(key_to_evict);
             }
             
             // Remove from TTL tracking
             if (it->second.has_ttl) {
-                ttl_set.erase({it->second.expires_at, key_to_evict});
+                sh.ttl_set.erase({it->second.expires_at, key_to_evict});
             }
             
-            g_data.erase(it);
+            sh.data.erase(it);
         }
     }
     else{
@@ -486,13 +973,47 @@ static void do_request(Response &resp, std::vector<std::string> &cmd){
     }
 }
 
-static bool try_one_request(Conn *conn){
+// Key a command operates on; commands without one run on the local shard
+static const std::string *request_key(const std::vector<std::string> &cmd){
+    if(cmd.size()==5 && cmd[0]=="set" && cmd[1]=="ex"){
+        return &cmd[2];
+    }
+    if(cmd.size()>=2){
+        return &cmd[1];
+    }
+    return nullptr;
+}
+
+static size_t shard_of(EventLoop *loop, const std::vector<std::string> &cmd){
+    if(g_shards.size()==1){
+        return 0;
+    }
+    const std::string *key=request_key(cmd);
+    if(!key){
+        return loop->id;
+    }
+    return std::hash<std::string>()(*key)%g_shards.size();
+}
+
+static void send_msg(EventLoop *loop, size_t to, ShardMsg &m){
+    std::deque<ShardMsg> &pending=loop->overflow[to];
+    if(pending.empty() && shard_queue(loop->id,to).push(m)){
+        loop->wake[to]=true;
+        return;
+    }
+    pending.push_back(std::move(m));
+}
+
+static bool try_one_request(EventLoop *loop, Conn *conn){
+    if(conn->waiting_remote){
+        return false;//resumed when the reply arrives
+    }
     if(conn->incoming.size()<4){
         return false;//want read
     }
     
     uint32_t len=0;
-    memcpy(&len,conn->incoming.data(),4);
+    conn->incoming.peek((uint8_t*)&len,4);
     if(len>max_msg){
         msg("too long");
         conn->want_close=true;
@@ -503,16 +1024,34 @@ static bool try_one_request(Conn *conn){
         return false;//want read
     }
     
-    const uint8_t *request=conn->incoming.data()+4;
+    const uint8_t *request=conn->incoming.contiguous((size_t)4+len)+4;
     //application logic
     std::vector<std::string> cmd;
     if(parse_req(request,len,cmd)<0){
         conn->want_close=true;
         return false;
     }
-    Response resp;
-    do_request(resp,cmd);
-    make_response(resp,conn->outgoing);
+    size_t target=shard_of(loop,cmd);
+    if(target!=(size_t)loop->id){
+        ShardMsg m;
+        m.fd=conn->fd;
+        m.conn_id=conn->id;
+        m.cmd.swap(cmd);
+        send_msg(loop,target,m);
+        conn->waiting_remote=true;
+        conn->incoming.consume((size_t)4+len);
+        return false;
+    }
+    
+    Shard &sh=*g_shards[target];
+    // Clean up expired entries before acquiring mutex to avoid deadlock
+    cleanup_expired(sh);
+    {
+        std::lock_guard<std::mutex> lock(sh.mutex);
+        Response resp;
+        do_request(sh,resp,cmd);
+        make_response(resp,conn->outgoing);
+    }
     
     conn->incoming.consume((size_t)4+len);
     return true;
@@ -520,72 +1059,594 @@ static bool try_one_request(Conn *conn){
 
 static void handle_write(Conn * conn){
     assert(conn->outgoing.size()>0);
-    ssize_t rv=write(conn->fd, conn->outgoing.data(), conn->outgoing.size());
-    if(rv<0 && errno==(EAGAIN|EWOULDBLOCK)){
-        return;//Socket not ready
+    do{
+        struct iovec iov[64];
+        int iovcnt=conn->outgoing.fill_iov(iov,64);
+        ssize_t rv=writev(conn->fd,iov,iovcnt);
+        if(rv<0 && errno==(EAGAIN|EWOULDBLOCK)){
+            return;//Socket not ready
+        }
+        
+        if(rv<0){
+            msg_errno("write() error");
+            conn->want_close=true;
+            return;
+        }
+        
+        conn->outgoing.consume((size_t)rv);
+        // Edge-triggered: keep writing until EAGAIN, the next EPOLLOUT edge
+        // only comes after the socket buffer filled up
+    }while(g_opts.edge_triggered && conn->outgoing.size()>0);
+    
+    if(conn->outgoing.size()==0){
+        conn->want_read=true;
+        conn->want_write=false;
+    }//else want write
+}
+
+// Run every complete request buffered on the connection and start writing
+// the responses
+static void process_incoming(EventLoop *loop, Conn *conn){
+    while(try_one_request(loop,conn)){}
+    
+    if(conn->outgoing.size()>0){
+        conn->want_read=false;
+        conn->want_write=true;
+        if(loop->uring){
+            return;//sends are queued by the io_uring loop
+        }
+        return handle_write(conn);//Attempt to write to socket as usually the socket is ready to read and write both
+    }// else want read
+}
+
+// When a frame larger than a chunk is partially buffered, give it a chunk of
+// its own so the remaining bytes are read straight into place
+static void prepare_frame(Conn *conn){
+    size_t have=conn->incoming.size();
+    if(have<4){
+        return;
+    }
+    uint32_t len=0;
+    conn->incoming.peek((uint8_t*)&len,4);
+    if(len<=max_msg && 4+(size_t)len>have && 4+(size_t)len>chunk_size){
+        conn->incoming.reserve_frame((size_t)4+len);
+    }
+}
+
+static void handle_read(EventLoop *loop, Conn * conn){
+    do{
+        prepare_frame(conn);
+        struct iovec iov[2];
+        int iovcnt=conn->incoming.prepare(iov);
+        ssize_t rv=readv(conn->fd,iov,iovcnt);
+        if(rv<0 && errno==(EAGAIN|EWOULDBLOCK)){
+            conn->readable=false;
+            conn->incoming.release_spare();
+            return;//Socket not ready
+        }
+        
+        if(rv<0){
+            msg_errno("read() error");
+            conn->want_close=true;
+            return;
+        }
+        
+        if(rv==0){
+            if(!conn->incoming.size()){
+                msg("client closed");
+            } else{
+                msg("unexpected EOF");
+            }
+            conn->want_close=true;
+            return;
+        }
+        
+        conn->incoming.commit((size_t)rv);
+        
+        process_incoming(loop,conn);
+        // Edge-triggered: drain the socket until EAGAIN as long as the
+        // responses could be flushed; otherwise `readable` stays set and
+        // reading resumes once the output drains
+    }while(g_opts.edge_triggered && conn->want_read && !conn->want_close);
+}
+
+// Edge-triggered mode: record readiness from the event, then make as much
+// progress as the connection state allows
+static void handle_edge_events(EventLoop *loop, Conn *conn, uint32_t events){
+    if(events & EPOLLIN){
+        conn->readable=true;
+    }
+    if((events & EPOLLOUT) && conn->want_write){
+        handle_write(conn);
+    }
+    if(conn->readable && conn->want_read && !conn->want_close){
+        handle_read(loop,conn);
+    }
+}
+
+static void uring_conn_close(EventLoop *loop, Conn *conn);
+static void uring_queue_send(EventLoop *loop, Conn *conn);
+
+static void conn_close(EventLoop *loop, Conn *conn){
+    if(loop->uring){
+        return uring_conn_close(loop,conn);
+    }
+    (void)epoll_ctl(loop->epfd,EPOLL_CTL_DEL,conn->fd,nullptr);
+    (void)close(conn->fd);
+    loop->fd2conn[conn->fd]=nullptr;
+    delete(conn);
+}
+
+static void deliver_reply(EventLoop *loop, ShardMsg &m){
+    if((size_t)m.fd>=loop->fd2conn.size()){
+        return;
+    }
+    Conn *conn=loop->fd2conn[m.fd];
+    if(!conn || conn->id!=m.conn_id || conn->want_close){
+        return;//connection closed while the request was in flight
     }
     
-    if(rv<0){
-        msg_errno("write() error");
-        conn->want_close=true;
+    Response resp;
+    resp.status=m.status;
+    if(m.ref){
+        resp.ref.swap(m.ref);
+        resp.len=resp.ref->size();
+        resp.data=(uint8_t*)resp.ref->data();
+    } else{
+        resp.len=m.payload.size();
+        resp.data=(uint8_t*)m.payload.data();
+    }
+    make_response(resp,conn->outgoing);
+    conn->waiting_remote=false;
+    
+    process_incoming(loop,conn);
+    if(g_opts.edge_triggered && conn->readable && conn->want_read && !conn->want_close){
+        handle_read(loop,conn);
+    }
+    if(conn->want_close){
+        conn_close(loop,conn);
         return;
     }
+    if(loop->uring){
+        uring_queue_send(loop,conn);
+        return;
+    }
+    conn_update_events(loop->epfd,conn);
+}
+
+// Serve requests other loops forwarded to our shard and deliver replies to
+// requests we forwarded
+static void handle_inbox(EventLoop *loop){
+    uint64_t count=0;
+    (void)read(loop->wakefd,&count,sizeof(count));
     
-    conn->outgoing.consume((size_t)rv);
+    Shard &sh=*g_shards[loop->id];
+    ShardMsg m;
+    for(size_t from=0;from<g_loops.size();from++){
+        if(from==(size_t)loop->id){
+            continue;
+        }
+        SpscQueue<ShardMsg> &q=shard_queue(from,loop->id);
+        while(q.pop(m)){
+            if(m.is_reply){
+                deliver_reply(loop,m);
+                continue;
+            }
+            
+            cleanup_expired(sh);
+            {
+                // Small payloads point into the shard, so copy them out under the lock
+                std::lock_guard<std::mutex> lock(sh.mutex);
+                Response resp;
+                do_request(sh,resp,m.cmd);
+                m.status=resp.status;
+                if(resp.ref && resp.len>=zero_copy_min){
+                    m.ref.swap(resp.ref);
+                } else{
+                    m.payload.assign((const char*)resp.data,resp.len);
+                }
+            }
+            m.is_reply=true;
+            m.cmd.clear();
+            send_msg(loop,from,m);
+        }
+    }
+}
+
+// Push queued messages and wake their destination loops. Returns true when
+// some messages still wait for queue space.
+static bool flush_outbox(EventLoop *loop){
+    bool pending=false;
+    for(size_t to=0;to<g_loops.size();to++){
+        std::deque<ShardMsg> &q=loop->overflow[to];
+        while(!q.empty() && shard_queue(loop->id,to).push(q.front())){
+            q.pop_front();
+            loop->wake[to]=true;
+        }
+        pending|=!q.empty();
+        
+        if(loop->wake[to]){
+            loop->wake[to]=false;
+            uint64_t one=1;
+            (void)write(g_loops[to].wakefd,&one,sizeof(one));
+        }
+    }
+    return pending;
+}
+
+// io_uring backend (--io-uring). The listener and every connection use
+// multishot accept/recv, received data lands in a ring of provided buffers,
+// and all sends queued during one iteration go out with the single
+// io_uring_enter that also waits for the next completions.
+
+enum {
+    URING_ACCEPT=1,
+    URING_WAKE=2,
+    URING_RECV=3,
+    URING_SEND=4,
+    URING_TIMEOUT=5,
+};
+
+const unsigned uring_entries=4096;
+const unsigned uring_buf_count=256; // provided receive buffers per loop
+const unsigned uring_buf_size=16*1024;
+const uint16_t uring_buf_group=0;
+
+struct Uring{
+    int fd=-1;
+    unsigned sq_entries=0;
+    unsigned *sq_head=nullptr;
+    unsigned *sq_tail=nullptr;
+    unsigned sq_mask=0;
+    struct io_uring_sqe *sqes=nullptr;
+    unsigned sqe_tail=0; // SQEs filled locally, published on submit
     
-    if(conn->outgoing.size()==0){
-        conn->want_read=true;
-        conn->want_write=false;
-    }//else want write
+    unsigned *cq_head=nullptr;
+    unsigned *cq_tail=nullptr;
+    unsigned cq_mask=0;
+    struct io_uring_cqe *cqes=nullptr;
+    
+    struct io_uring_buf_ring *buf_ring=nullptr;
+    uint8_t *buf_base=nullptr;
+    uint16_t buf_tail=0;
+    
+    struct __kernel_timespec timeout={};
+};
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p){
+    return (int)syscall(__NR_io_uring_setup,entries,p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags){
+    return (int)syscall(__NR_io_uring_enter,fd,to_submit,min_complete,flags,nullptr,0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args){
+    return (int)syscall(__NR_io_uring_register,fd,opcode,arg,nr_args);
+}
+
+// Hand a receive buffer back to the kernel
+static void uring_recycle_buf(Uring *ring, uint16_t bid){
+    // Index from the ring base: in C++ the header's flexible `bufs` member
+    // does not start at offset 0
+    struct io_uring_buf *buf=(struct io_uring_buf*)ring->buf_ring+(ring->buf_tail & (uring_buf_count-1));
+    buf->addr=(uint64_t)(uintptr_t)(ring->buf_base+(size_t)bid*uring_buf_size);
+    buf->len=uring_buf_size;
+    buf->bid=bid;
+    ring->buf_tail++;
+    __atomic_store_n(&ring->buf_ring->tail,ring->buf_tail,__ATOMIC_RELEASE);
 }
 
-static void handle_read(Conn * conn){
-    uint8_t buf[64*1024];
-    ssize_t rv=read(conn->fd,buf,sizeof(buf));
-    if(rv<0 && errno==(EAGAIN|EWOULDBLOCK)){
-        return;//Socket not ready
+static bool uring_init(Uring *ring){
+    struct io_uring_params p={};
+    p.flags=IORING_SETUP_CQSIZE;
+    p.cq_entries=uring_entries*4;
+    ring->fd=sys_io_uring_setup(uring_entries,&p);
+    if(ring->fd<0){
+        return false;
+    }
+    
+    size_t sq_size=p.sq_off.array+p.sq_entries*sizeof(unsigned);
+    size_t cq_size=p.cq_off.cqes+p.cq_entries*sizeof(struct io_uring_cqe);
+    bool single_mmap=p.features & IORING_FEAT_SINGLE_MMAP;
+    if(single_mmap){
+        sq_size=cq_size=std::max(sq_size,cq_size);
+    }
+    uint8_t *sq=(uint8_t*)mmap(nullptr,sq_size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,ring->fd,IORING_OFF_SQ_RING);
+    if(sq==MAP_FAILED){
+        return false;
+    }
+    uint8_t *cq=sq;
+    if(!single_mmap){
+        cq=(uint8_t*)mmap(nullptr,cq_size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,ring->fd,IORING_OFF_CQ_RING);
+        if(cq==MAP_FAILED){
+            return false;
+        }
+    }
+    ring->sqes=(struct io_uring_sqe*)mmap(nullptr,p.sq_entries*sizeof(struct io_uring_sqe),PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,ring->fd,IORING_OFF_SQES);
+    if(ring->sqes==MAP_FAILED){
+        return false;
+    }
+    
+    ring->sq_entries=p.sq_entries;
+    ring->sq_head=(unsigned*)(sq+p.sq_off.head);
+    ring->sq_tail=(unsigned*)(sq+p.sq_off.tail);
+    ring->sq_mask=*(unsigned*)(sq+p.sq_off.ring_mask);
+    ring->sqe_tail=*ring->sq_tail;
+    // SQE slots are used in order, so the index array is the identity map
+    unsigned *sq_array=(unsigned*)(sq+p.sq_off.array);
+    for(unsigned i=0;i<p.sq_entries;i++){
+        sq_array[i]=i;
+    }
+    ring->cq_head=(unsigned*)(cq+p.cq_off.head);
+    ring->cq_tail=(unsigned*)(cq+p.cq_off.tail);
+    ring->cq_mask=*(unsigned*)(cq+p.cq_off.ring_mask);
+    ring->cqes=(struct io_uring_cqe*)(cq+p.cq_off.cqes);
+    
+    // Provided buffer ring shared by every multishot recv on this loop
+    ring->buf_ring=(struct io_uring_buf_ring*)mmap(nullptr,uring_buf_count*sizeof(struct io_uring_buf),PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+    if(ring->buf_ring==MAP_FAILED){
+        return false;
+    }
+    ring->buf_base=(uint8_t*)malloc((size_t)uring_buf_count*uring_buf_size);
+    if(!ring->buf_base){
+        return false;
+    }
+    struct io_uring_buf_reg reg={};
+    reg.ring_addr=(uint64_t)(uintptr_t)ring->buf_ring;
+    reg.ring_entries=uring_buf_count;
+    reg.bgid=uring_buf_group;
+    if(sys_io_uring_register(ring->fd,IORING_REGISTER_PBUF_RING,&reg,1)<0){
+        return false;
+    }
+    for(unsigned i=0;i<uring_buf_count;i++){
+        uring_recycle_buf(ring,(uint16_t)i);
+    }
+    return true;
+}
+
+// Publish queued SQEs and optionally wait for at least one completion
+static void uring_submit(Uring *ring, bool wait){
+    __atomic_store_n(ring->sq_tail,ring->sqe_tail,__ATOMIC_RELEASE);
+    unsigned to_submit=ring->sqe_tail-__atomic_load_n(ring->sq_head,__ATOMIC_ACQUIRE);
+    if(!to_submit && !wait){
+        return;
+    }
+    int rv=sys_io_uring_enter(ring->fd,to_submit,wait ? 1 : 0,wait ? IORING_ENTER_GETEVENTS : 0);
+    if(rv<0 && errno!=EINTR && errno!=EBUSY && errno!=EAGAIN){
+        die("io_uring_enter()");
+    }
+}
+
+static struct io_uring_sqe *uring_sqe(Uring *ring, uint8_t opcode, int fd, uint64_t user_data){
+    if(ring->sqe_tail-__atomic_load_n(ring->sq_head,__ATOMIC_ACQUIRE)>=ring->sq_entries){
+        uring_submit(ring,false);//SQ full, hand what we have to the kernel
+    }
+    struct io_uring_sqe *sqe=&ring->sqes[ring->sqe_tail & ring->sq_mask];
+    ring->sqe_tail++;
+    memset(sqe,0,sizeof(*sqe));
+    sqe->opcode=opcode;
+    sqe->fd=fd;
+    sqe->user_data=user_data;
+    return sqe;
+}
+
+// Conn objects are 8-byte aligned, so the operation fits in the low bits
+static uint64_t uring_data(Conn *conn, uint64_t op){
+    return (uint64_t)(uintptr_t)conn | op;
+}
+
+static void uring_arm_accept(EventLoop *loop){
+    struct io_uring_sqe *sqe=uring_sqe(loop->uring,IORING_OP_ACCEPT,loop->listening_sd,URING_ACCEPT);
+    sqe->ioprio=IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags=SOCK_NONBLOCK|SOCK_CLOEXEC;
+}
+
+static void uring_arm_wake(EventLoop *loop){
+    struct io_uring_sqe *sqe=uring_sqe(loop->uring,IORING_OP_POLL_ADD,loop->wakefd,URING_WAKE);
+    sqe->poll32_events=POLLIN;
+    sqe->len=IORING_POLL_ADD_MULTI;
+}
+
+static void uring_arm_recv(EventLoop *loop, Conn *conn){
+    struct io_uring_sqe *sqe=uring_sqe(loop->uring,IORING_OP_RECV,conn->fd,uring_data(conn,URING_RECV));
+    sqe->ioprio=IORING_RECV_MULTISHOT;
+    sqe->flags=IOSQE_BUFFER_SELECT;
+    sqe->buf_group=uring_buf_group;
+    conn->recv_armed=true;
+}
+
+static void uring_queue_send(EventLoop *loop, Conn *conn){
+    if(conn->send_inflight || conn->want_close){
+        return;//the completion handler sends the rest
     }
+    if(conn->sending.size()==0){
+        if(conn->outgoing.size()==0){
+            return;
+        }
+        conn->sending.swap(conn->outgoing);
+    }
+    if(!conn->uring_send){
+        conn->uring_send.reset(new UringSend());
+    }
+    UringSend *us=conn->uring_send.get();
+    memset(&us->msg,0,sizeof(us->msg));
+    us->msg.msg_iov=us->iov;
+    us->msg.msg_iovlen=conn->sending.fill_iov(us->iov,16);
     
-    if(rv<0){
-        msg_errno("read() error");
+    struct io_uring_sqe *sqe=uring_sqe(loop->uring,IORING_OP_SENDMSG,conn->fd,uring_data(conn,URING_SEND));
+    sqe->addr=(uint64_t)(uintptr_t)&us->msg;
+    sqe->len=1;
+    sqe->msg_flags=MSG_NOSIGNAL;
+    conn->send_inflight=true;
+}
+
+static void uring_conn_close(EventLoop *loop, Conn *conn){
+    if(!conn->want_close){
         conn->want_close=true;
+    }
+    if(conn->recv_armed){
+        // Terminates the multishot recv; we get back here from its last CQE
+        (void)shutdown(conn->fd,SHUT_RDWR);
+        return;
+    }
+    if(conn->send_inflight){
         return;
     }
+    (void)close(conn->fd);
+    loop->fd2conn[conn->fd]=nullptr;
+    delete(conn);
+}
+
+static void uring_handle_recv(EventLoop *loop, Conn *conn, struct io_uring_cqe *cqe){
+    Uring *ring=loop->uring;
+    if(!(cqe->flags & IORING_CQE_F_MORE)){
+        conn->recv_armed=false;
+    }
     
-    if(rv==0){
-        if(!conn->incoming.size()){
-            msg("client closed");
+    if(cqe->res>0 && (cqe->flags & IORING_CQE_F_BUFFER)){
+        uint16_t bid=cqe->flags>>IORING_CQE_BUFFER_SHIFT;
+        if(!conn->want_close){
+            conn->incoming.append(ring->buf_base+(size_t)bid*uring_buf_size,(size_t)cqe->res);
+        }
+        uring_recycle_buf(ring,bid);
+        if(!conn->want_close){
+            process_incoming(loop,conn);
+        }
+    } else if(cqe->res==-ENOBUFS){
+        // Every provided buffer was busy; re-armed below
+    } else if(!conn->want_close){
+        if(cqe->res==0){
+            msg(conn->incoming.size() ? "unexpected EOF" : "client closed");
         } else{
-            msg("unexpected EOF");
+            errno=-cqe->res;
+            msg_errno("recv() error");
         }
         conn->want_close=true;
-        return;
     }
     
-    conn->incoming.append(buf,(size_t)rv);
-    
-    while(try_one_request(conn)){}
+    if(conn->want_close){
+        return uring_conn_close(loop,conn);
+    }
+    if(!conn->recv_armed){
+        uring_arm_recv(loop,conn);
+    }
+    uring_queue_send(loop,conn);
+}
+
+static void uring_handle_send(EventLoop *loop, Conn *conn, struct io_uring_cqe *cqe){
+    conn->send_inflight=false;
+    if(cqe->res<0){
+        if(!conn->want_close){
+            errno=-cqe->res;
+            msg_errno("send() error");
+        }
+        return uring_conn_close(loop,conn);
+    }
+    conn->sending.consume((size_t)cqe->res);
+    if(conn->want_close){
+        return uring_conn_close(loop,conn);
+    }
+    uring_queue_send(loop,conn);
+    if(!conn->send_inflight){
+        conn->want_read=true;
+        conn->want_write=false;
+    }
+}
+
+static void uring_loop_run(EventLoop *loop){
+    Uring *ring=loop->uring;
+    uring_arm_accept(loop);
+    uring_arm_wake(loop);
     
-    if(conn->outgoing.size()>0){
-        conn->want_read=false;
-        conn->want_write=true;
-        return handle_write(conn);//Attempt to write to socket as usually the socket is ready to read and write both
-    }// else want read
+    bool outbox_pending=false;
+    while(true)
+    {
+        if(outbox_pending){
+            // Retry soon when other loops' queues were full
+            ring->timeout.tv_sec=0;
+            ring->timeout.tv_nsec=1000*1000;
+            struct io_uring_sqe *sqe=uring_sqe(ring,IORING_OP_TIMEOUT,-1,URING_TIMEOUT);
+            sqe->addr=(uint64_t)(uintptr_t)&ring->timeout;
+            sqe->len=1;
+        }
+        uring_submit(ring,true);
+        
+        unsigned head=*ring->cq_head;
+        unsigned tail=__atomic_load_n(ring->cq_tail,__ATOMIC_ACQUIRE);
+        for(;head!=tail;head++){
+            struct io_uring_cqe cqe=ring->cqes[head & ring->cq_mask];
+            uint64_t op=cqe.user_data & 7;
+            Conn *conn=(Conn*)(uintptr_t)(cqe.user_data & ~(uint64_t)7);
+            
+            switch(op){
+            case URING_ACCEPT:
+                if(cqe.res>=0){
+                    fprintf(stderr,"new incoming connection (fd %d)\n",cqe.res);
+                    uring_arm_recv(loop,conn_new(loop,cqe.res));
+                } else{
+                    errno=-cqe.res;
+                    msg_errno("accept() error");
+                }
+                if(!(cqe.flags & IORING_CQE_F_MORE)){
+                    uring_arm_accept(loop);
+                }
+                break;
+            case URING_WAKE:
+                handle_inbox(loop);
+                if(!(cqe.flags & IORING_CQE_F_MORE)){
+                    uring_arm_wake(loop);
+                }
+                break;
+            case URING_RECV:
+                uring_handle_recv(loop,conn,&cqe);
+                break;
+            case URING_SEND:
+                uring_handle_send(loop,conn,&cqe);
+                break;
+            default:
+                break;
+            }
+        }
+        __atomic_store_n(ring->cq_head,head,__ATOMIC_RELEASE);
+        
+        outbox_pending=flush_outbox(loop);
+    }
 }
 
 // Background cleanup thread function
 static void cleanup_thread() {
     while (true) {
         std::this_thread::sleep_for(std::chrono::seconds(1));
-        cleanup_expired();
+        for (auto &sh : g_shards) {
+            cleanup_expired(*sh);
+        }
     }
 }
 
-int main() {
-    // Start background cleanup thread
-    std::thread cleanup_worker(cleanup_thread);
-    cleanup_worker.detach();
+static void usage(const char *prog){
+    fprintf(stderr,"usage: %s [--threads N] [--io-uring] [--edge-triggered]\n",prog);
+    exit(1);
+}
+
+static void parse_args(int argc, char **argv){
+    for(int i=1;i<argc;i++){
+        if(!strcmp(argv[i],"--threads") && i+1<argc){
+            g_opts.threads=atoi(argv[++i]);
+            if(g_opts.threads<1){
+                usage(argv[0]);
+            }
+        } else if(!strcmp(argv[i],"--io-uring")){
+            g_opts.io_uring=true;
+        } else if(!strcmp(argv[i],"--edge-triggered")){
+            g_opts.edge_triggered=true;
+        } else{
+            usage(argv[0]);
+        }
+    }
+}
 
+static int create_listener(){
     int listening_sd=socket(AF_INET, SOCK_STREAM,0); //listening socket descriptor defined
     
     if(listening_sd<0){
@@ -594,6 +1655,13 @@ int main() {
     
     int opt=1;
     setsockopt(listening_sd,SOL_SOCKET,SO_REUSEADDR,&opt,sizeof(opt));//set options
+    if(g_opts.threads>1){
+        // Every event loop binds its own socket to the port and the kernel
+        // spreads incoming connections across them
+        if(setsockopt(listening_sd,SOL_SOCKET,SO_REUSEPORT,&opt,sizeof(opt))<0){
+            die("SO_REUSEPORT failed");
+        }
+    }
     
     struct sockaddr_in addr={};
     addr.sin_family=AF_INET;
@@ -613,52 +1681,66 @@ int main() {
     {
         die("listen failed");
     }
+    return listening_sd;
+}
+
+static void event_loop_init(EventLoop *loop, int id){
+    loop->id=id;
+    loop->listening_sd=create_listener();
+    loop->overflow.resize(g_opts.threads);
+    loop->wake.resize(g_opts.threads);
     
-    std::vector<Conn*> fd2conn;
-    std::vector<struct epoll_event> epoll_args; 
+    loop->wakefd=eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+    if(loop->wakefd<0){
+        die("eventfd()");
+    }
+    
+    if(g_opts.io_uring){
+        loop->uring=new Uring();
+        if(!uring_init(loop->uring)){
+            die("io_uring setup failed (multishot recv needs Linux 6.0+)");
+        }
+        return;
+    }
+    
+    loop->epfd=epoll_create1(EPOLL_CLOEXEC);
+    if(loop->epfd<0){
+        die("epoll()");
+    }
+    
+    struct epoll_event listening_fd_ee={};
+    listening_fd_ee.events=EPOLLIN;
+    listening_fd_ee.data.fd=loop->listening_sd;
+    if(epoll_ctl(loop->epfd,EPOLL_CTL_ADD,loop->listening_sd,&listening_fd_ee)<0){
+        die("epoll_ctl()");
+    }
+    
+    struct epoll_event wake_ee={};
+    wake_ee.events=EPOLLIN;
+    wake_ee.data.fd=loop->wakefd;
+    if(epoll_ctl(loop->epfd,EPOLL_CTL_ADD,loop->wakefd,&wake_ee)<0){
+        die("epoll_ctl()");
+    }
+    
+    loop->epoll_args.resize(1024);
+}
+
+static void event_loop_run(EventLoop *loop){
+    if(loop->uring){
+        return uring_loop_run(loop);
+    }
     
+    int epfd=loop->epfd;
+    int listening_sd=loop->listening_sd;
+    std::vector<Conn*> &fd2conn=loop->fd2conn;
+    std::vector<struct epoll_event> &epoll_args=loop->epoll_args;
+    
+    bool outbox_pending=false;
     while(true)
     {   
-        epoll_args.clear();
-        
-        int epfd=epoll_create1(0);
-        
-        if(epfd<0){
-            die("epoll()");
-        }
-        
-        struct epoll_event listening_fd_ee;
-        listening_fd_ee.events=EPOLLIN;
-        listening_fd_ee.data.fd=listening_sd;
-        
-        epoll_ctl(epfd,EPOLL_CTL_ADD,listening_sd,&listening_fd_ee);
-        
-        int max_events=1;
-        
-        for(Conn* conn:fd2conn){
-            if(!conn){
-                continue;
-            }
-            
-            struct epoll_event efd_event;
-            efd_event.data.fd = conn->fd;
-            efd_event.events=EPOLLERR;
-            
-            if(conn->want_write){
-                efd_event.events|=EPOLLOUT;
-            }
-            
-            if(conn->want_read){
-                efd_event.events|=EPOLLIN;
-            }
-            
-            max_events++;
-            epoll_ctl(epfd,EPOLL_CTL_ADD,conn->fd,&efd_event);
-        }
-        
-        epoll_args.resize(max_events);
-        
-        int val=epoll_wait(epfd,epoll_args.data(),max_events,-1);
+        // Retry soon when other loops' queues were full
+        int timeout=outbox_pending ? 1 : -1;
+        int val=epoll_wait(epfd,epoll_args.data(),(int)epoll_args.size(),timeout);
         if(val==-1 && errno==EINTR){
             continue;
         }
@@ -670,38 +1752,83 @@ int main() {
             
             if(epoll_args[i].data.fd==listening_sd){
                 if(epoll_args[i].events & EPOLLIN){
-                    if(Conn *conn=handle_accept(listening_sd)){
-                        if(fd2conn.size()<=(size_t)conn->fd){
-                            fd2conn.resize(conn->fd+1);
-                        }
-                        assert(!fd2conn[conn->fd]);
-                        fd2conn[conn->fd]=conn;
-                    }
+                    (void)handle_accept(loop);
                 }
                 continue;
             }
             
-            Conn* conn=(Conn *)fd2conn[epoll_args[i].data.fd];
-            
-            if(epoll_args[i].events & EPOLLIN){
-                assert(conn->want_read);
-                conn->want_read=true;
-                handle_read(conn);
+            if(epoll_args[i].data.fd==loop->wakefd){
+                handle_inbox(loop);
+                continue;
             }
             
-            if(epoll_args[i].events & EPOLLOUT){
-                assert(conn->want_write);
-                conn->want_write=true;
-                handle_write(conn);
+            Conn* conn=(Conn *)fd2conn[epoll_args[i].data.fd];
+            
+            if(g_opts.edge_triggered){
+                handle_edge_events(loop,conn,epoll_args[i].events);
+            } else{
+                if(epoll_args[i].events & EPOLLIN){
+                    assert(conn->want_read);
+                    handle_read(loop,conn);
+                }
+                
+                if((epoll_args[i].events & EPOLLOUT) && !conn->want_close){
+                    assert(conn->want_write);
+                    handle_write(conn);
+                }
+                
+                if(!conn->want_close){
+                    conn_update_events(epfd,conn);
+                }
             }
             
             if((epoll_args[i].events & EPOLLERR) || conn->want_close){
-                (void)close(conn->fd);
-                fd2conn[epoll_args[i].data.u32]=nullptr;
-                delete(conn);
+                conn_close(loop,conn);
             }
         }
+        
+        outbox_pending=flush_outbox(loop);
+        
+        // Grow the event array when it was filled so a burst is drained in one wait
+        if((size_t)val==epoll_args.size()){
+            epoll_args.resize(epoll_args.size()*2);
+        }
     }
+}
+
+int main(int argc, char **argv) {
+    parse_args(argc,argv);
     
+    // A peer that resets while we write must not kill the server
+    signal(SIGPIPE,SIG_IGN);
+    
+    // One keyspace shard per loop, with a queue for every ordered pair of loops
+    size_t nloops=g_opts.threads;
+    for(size_t i=0;i<nloops;i++){
+        g_shards.push_back(std::unique_ptr<Shard>(new Shard()));
+    }
+    for(size_t i=0;i<nloops*nloops;i++){
+        g_queues.push_back(std::unique_ptr<SpscQueue<ShardMsg>>(new SpscQueue<ShardMsg>(shard_queue_cap)));
+    }
+    
+    // Start background cleanup thread
+    std::thread cleanup_worker(cleanup_thread);
+    cleanup_worker.detach();
+    
+    // Bind every listener up front so a port conflict fails before any loop runs
+    g_loops.resize(nloops);
+    for(size_t i=0;i<nloops;i++){
+        event_loop_init(&g_loops[i],i);
+    }
+    
+    std::vector<std::thread> workers;
+    for(size_t i=1;i<nloops;i++){
+        workers.push_back(std::thread(event_loop_run,&g_loops[i]));
+    }
+    event_loop_run(&g_loops[0]);
+    
+    for(std::thread &t:workers){
+        t.join();
+    }
     return 0;
 }
\ No newline at end of file